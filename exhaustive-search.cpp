@@ -6,25 +6,192 @@
 #include <set>
 #include <map>
 #include <fstream>
+#include <sstream>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <functional>
 #include <assert.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #define n_rack     8 
 #define Back_Bed  'b'
 #define Front_Bed 'f'
+#define Patterns_File "patterns.pdb"
 
 typedef std::pair<char, int> BN;
+typedef std::pair<BN, BN> Xfer;
 
 // signature should use the machine state to work with firsts
 typedef std::pair<int, std::map< std::pair<char,int>, std::vector<int> > > Signature;
 
-int n_stitches = 0;
+// result of searching a single row, xfers are in the order they should be executed
+struct Plan{
+	std::vector<Xfer> xfers;
+	int passes = 0;
+	int lower_bound = 0;
+	bool optimal = false; // false if the deadline cut the search short
+	// search stats
+	long expanded = 0;
+	double milliseconds = 0;
+};
 
+// Pattern table: optimal plans for every cable-free window up to some width, built
+// offline by --build-patterns and memory-mapped at startup.
+// Layout (native endianness): PatternHeader, PatternRecord[records] sorted by key,
+// PatternXfer[xfers]; needles in a record's xfers are relative to the window start.
+struct PatternHeader{
+	char magic[8];
+	uint32_t width;
+	uint32_t max_offset;
+	uint32_t records;
+	uint32_t xfers;
+};
+struct PatternRecord{
+	uint64_t key;
+	uint32_t first_xfer;
+	uint16_t xfers;
+	uint8_t passes;
+	uint8_t width;
+};
+struct PatternXfer{
+	char from_bed;
+	int8_t from_needle;
+	char to_bed;
+	int8_t to_needle;
+};
+static const char Patterns_Magic[8] = {'L','A','C','E','P','D','B','1'};
 
+// key for the window [begin, begin + width) of a row: 4 bits of width, then 3 bits of
+// offset and 1 bit of first per stitch. A first only counts if its stack is inside the
+// window, so a window of a longer row gets the key of the same row standing alone.
+// Returns false if the window can't be in the table (too wide, offsets too long, cables).
+bool pattern_key( const std::vector<int> &offsets, const std::vector<int> &firsts, int begin, int width, uint64_t &key){
+	if( width < 1 || width > 15 ) return false;
+	key = width;
+	for(int i = begin; i < begin + width; i++){
+		if( std::abs(offsets[i]) > 3 ) return false;
+		if( i > begin && i + offsets[i] < i-1 + offsets[i-1] ) return false;
+		bool first = false;
+		for(int j = begin; firsts[i] && j < begin + width; j++){
+			if( j != i && j + offsets[j] == i + offsets[i] ) first = true;
+		}
+		key = (key << 4) | (uint64_t)((offsets[i] + 3) << 1) | (first ? 1 : 0);
+	}
+	return true;
+}
+
+struct PatternTable{
+	const PatternHeader *header = nullptr;
+	const PatternRecord *records = nullptr;
+	const PatternXfer *xfers = nullptr;
+	void *data = MAP_FAILED;
+	size_t size = 0;
+
+	bool open( std::string path ){
+		close();
+		int fd = ::open(path.c_str(), O_RDONLY);
+		if(fd < 0) return false;
+		struct stat st;
+		if(fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(PatternHeader)){
+			size = st.st_size;
+			data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		}
+		::close(fd);
+		if(data == MAP_FAILED) return false;
+		header = (const PatternHeader*)data;
+		records = (const PatternRecord*)(header + 1);
+		xfers = (const PatternXfer*)(records + header->records);
+		if( !valid() ){
+			std::cerr << "ignoring malformed pattern table " << path << std::endl;
+			close();
+			return false;
+		}
+		return true;
+	}
+	// find and plan trust the records, so check every one of them against the header
+	// (a stale or corrupt file must not send them outside the mapping)
+	bool valid() const{
+		if( memcmp(header->magic, Patterns_Magic, sizeof(Patterns_Magic)) != 0 ||
+			header->width < 1 || header->width > 15 ||
+			size != sizeof(PatternHeader) + (size_t)header->records * sizeof(PatternRecord) + (size_t)header->xfers * sizeof(PatternXfer) ){
+			return false;
+		}
+		for(uint32_t i = 0; i < header->records; i++){
+			const PatternRecord &r = records[i];
+			if( r.width < 1 || r.width > header->width ) return false;
+			if( (uint64_t)r.first_xfer + r.xfers > header->xfers ) return false;
+			if( i > 0 && records[i-1].key >= r.key ) return false;
+		}
+		return true;
+	}
+	void close(){
+		if(data != MAP_FAILED) munmap(data, size);
+		data = MAP_FAILED;
+		header = nullptr;
+	}
+	~PatternTable(){
+		close();
+	}
+	int width() const{
+		return header ? header->width : 0;
+	}
+	const PatternRecord* find( uint64_t key ) const{
+		if(!header) return nullptr;
+		auto end = records + header->records;
+		auto r = std::lower_bound(records, end, key, [](const PatternRecord &rec, uint64_t k){ return rec.key < k; });
+		return (r != end && r->key == key) ? r : nullptr;
+	}
+	// the record's plan moved over to start at needle begin
+	std::vector<Xfer> plan( const PatternRecord *r, int begin ) const{
+		std::vector<Xfer> plan;
+		for(int i = 0; i < r->xfers; i++){
+			const PatternXfer &x = xfers[r->first_xfer + i];
+			plan.push_back(std::make_pair(std::make_pair(x.from_bed, begin + x.from_needle), std::make_pair(x.to_bed, begin + x.to_needle)));
+		}
+		return plan;
+	}
+};
+
+struct SearchOptions{
+	// passes used by a plan that is already known (e.g. from a heuristic planner),
+	// pruning starts from the first node and only a strictly better plan is returned
+	// (exhaustive_plan returns false if it finds nothing below this)
+	int upper_bound = INT32_MAX;
+	// give up and return the best plan so far after this long, 0 means no deadline
+	int deadline_ms = 0;
+	// verbose = false keeps quiet so that many rows can be solved at once
+	bool verbose = true;
+	// also search backward from the goal and meet in the middle
+	bool bidirectional = false;
+	// largest racking plans may use (e.g. the limit the heuristic planners were given)
+	int max_rack = n_rack;
+	// optimal plans for small windows, used as a lower bound and to answer small rows directly
+	const PatternTable *patterns = nullptr;
+};
 
-bool exhaustive( std::vector<int> offsets, std::vector<int> firsts , std::string outfile="out.xfers"){
+// searches for a transfer plan with the fewest passes,
+// returns false if there is no plan within the upper bound (or none was found before the deadline),
+// or if the row is one exhaustive can't plan (cables, two firsts on one target, a plan
+// below the formula lower bound)
+bool exhaustive_plan( std::vector<int> offsets, std::vector<int> firsts, Plan &plan, SearchOptions options = SearchOptions()){
 
 	assert( offsets.size() == firsts.size() && " offsets and firsts must have the same size " );
-	assert( offsets.size() == (size_t)n_stitches && " number of stitches is fixed " );
+	const int n_stitches = offsets.size();
+	std::ostream null_out(nullptr);
+	std::ostream &log_out = (options.verbose ? std::cout : null_out);
+	const auto started = std::chrono::steady_clock::now();
+	const auto deadline = started + std::chrono::milliseconds(options.deadline_ms);
+	auto Elapsed = [=]()->double{
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started).count();
+	};
+	plan = Plan();
 
 	bool ignore_firsts = false;
 	auto temp = offsets;
@@ -33,8 +200,8 @@ bool exhaustive( std::vector<int> offsets, std::vector<int> firsts , std::string
 	temp.erase(last, temp.end());
 	int lower_bound_passes = temp.size();
 	
-	std::cout<<std::endl;
-	int upper_bound_passes =  INT32_MAX; 
+	log_out<<std::endl;
+	int upper_bound_passes = options.upper_bound;
 	//TODO compute a better lower bound for when firsts exist
 	for(int i = 0; i < (int)temp.size(); i++){
 		if(temp[i] == 0){
@@ -58,11 +225,11 @@ bool exhaustive( std::vector<int> offsets, std::vector<int> firsts , std::string
 				ofs.insert(offsets[i]);
 			}
 		}
-		std::cout<<"unique offsets"<<std::endl;
+		log_out<<"unique offsets"<<std::endl;
 		for(auto o : ofs){
-			std::cout<<o << " ";
+			log_out<<o << " ";
 		}
-		std::cout<<std::endl;
+		log_out<<std::endl;
 		lower_bound_passes = ofs.size();
 
 		// sanity check targets 
@@ -73,7 +240,9 @@ bool exhaustive( std::vector<int> offsets, std::vector<int> firsts , std::string
 				for(int j = 0; j < n_stitches; j++){
 					if( j == i ) continue;
 					if( firsts[j] && targets[j] == targets[i]){
-						assert(false && "two indices with the same target cannot both be first");
+						log_out << "two indices with the same target cannot both be first" << std::endl;
+						plan.milliseconds = Elapsed();
+						return false;
 					}
 					if(targets[j] == targets[i]){
 						not_stacked = false;
@@ -110,7 +279,9 @@ bool exhaustive( std::vector<int> offsets, std::vector<int> firsts , std::string
 			}
 		}
 		if( !up_okay && !dn_okay ){
-			assert(false && "exhaustive search does not support cables!");
+			log_out << "exhaustive search does not support cables!" << std::endl;
+			plan.milliseconds = Elapsed();
+			return false;
 		}
 		
 	}
@@ -122,14 +293,29 @@ bool exhaustive( std::vector<int> offsets, std::vector<int> firsts , std::string
 		}
 	}
 	if(all_zeros && ignore_firsts){
-		// ah need to write an empty file:
-
-		std::ofstream out(outfile);
-		out.close();
-		std::cout<<"all zeros, return!" << lower_bound_passes << std::endl;
+		// empty plan
+		log_out<<"all zeros, return!" << lower_bound_passes << std::endl;
+		plan.optimal = true;
+		plan.milliseconds = Elapsed();
 		return true;
 	}
-	std::cout << "lower bound = " << lower_bound_passes << std::endl;
+	// dropping stitches from a plan never adds passes, so the optimum of any window of
+	// the row is a lower bound for the whole row, and wider windows are at least as good
+	const int formula_lower_bound = lower_bound_passes;
+	if(options.patterns){
+		for(int begin = 0; begin < n_stitches; begin++){
+			for(int width = std::min(options.patterns->width(), n_stitches - begin); width > 0; width--){
+				uint64_t key = 0;
+				const PatternRecord *r = nullptr;
+				if(pattern_key(offsets, firsts, begin, width, key) && (r = options.patterns->find(key))){
+					lower_bound_passes = std::max(lower_bound_passes, (int)r->passes);
+					break;
+				}
+			}
+		}
+	}
+	log_out << "lower bound = " << lower_bound_passes << std::endl;
+	plan.lower_bound = lower_bound_passes;
 	struct State{
 		std::vector<int> currents;
 		std::vector<int> offsets;
@@ -511,6 +697,51 @@ bool exhaustive( std::vector<int> offsets, std::vector<int> firsts , std::string
 		*/
 	};
 
+	// applies the transfer of idx (and whatever is stacked with it) to the opposite bed at racking ofs,
+	// okay_to_move_index_by_offset should have been checked first
+	auto MoveIndexByOffset = [=](State &top, int idx, int ofs)->void{
+		BN from = std::make_pair( top.beds[idx],  top.currents[idx]);
+		int prev_offset = top.offsets[idx];
+		(void)prev_offset;
+		//front-to-back
+		//std::cout<<"\t idx = "<<idx<<" "<< top.beds[idx] << top.currents[idx] << " moved to ";
+		if(top.beds[idx] == Front_Bed){
+			top.offsets[idx] += ofs;
+			top.currents[idx] -= ofs;
+		}
+		else{ //Back-to-front
+			top.offsets[idx] -= ofs;
+			top.currents[idx] += ofs;
+		}
+		top.beds[idx] = Opposite(top, idx);
+		
+		
+		//std::cout<<" to-target: "<<top.beds[idx]<<top.currents[idx]<<std::endl;
+		BN to = std::make_pair( top.beds[idx],  top.currents[idx]);
+
+		auto froms = top.machine[from];
+		auto tos = top.machine[to];
+		std::reverse(froms.begin(), froms.end());
+		for(auto in : froms){
+			//if(in != idx){
+			//std::cout<<"\t\tidx = "<<idx<<" index " << in << " at from "<<top.beds[in] << top.currents[in] << " moved to target "<<std::endl;
+			//}
+			top.machine[to].push_back(in);
+			assert(in == idx || top.currents[in] == from.second);
+			assert(in == idx || top.beds[in] == from.first);
+			top.currents[in] = top.currents[idx];
+			top.beds[in] = top.beds[idx];
+			// if these didn't match this action would not have been possible
+			assert(in == idx || top.offsets[in] == prev_offset);
+			top.offsets[in] = top.offsets[idx];
+		}
+		top.xfers.push_back( std::make_pair(from, to));
+		//	std::cout<<"\txfer "<<Bed(from)<<Needle(from)<<" -> "<<Bed(to)<<Needle(to)<<std::endl;
+		//	Passes(top.xfers , true);
+
+		top.machine[from].clear();
+	};
+
 	auto make_signature = [=](const State &s)->Signature{
 		auto p = Passes(s.xfers);
 		return  std::make_pair( p, s.machine );
@@ -560,6 +791,49 @@ bool exhaustive( std::vector<int> offsets, std::vector<int> firsts , std::string
 	first.est_passes = LowerBoundFromHere(first);
 	PQ.push(first);
 
+	// if everything that moves fits in one table window (with a stitch of margin on either
+	// side, for slack) the table's plan is optimal here too, as long as it is still legal
+	// next to the rest of the row
+	if(options.patterns){
+		int lo = n_stitches;
+		int hi = -1;
+		for(int i = 0; i < n_stitches; i++){
+			if(offsets[i] == 0 && !firsts[i]) continue;
+			lo = std::min(lo, std::max(0, std::min(i, targets[i])) );
+			hi = std::max(hi, std::min(n_stitches - 1, std::max(i, targets[i])) );
+		}
+		lo = std::max(0, lo - 1);
+		hi = std::min(n_stitches - 1, hi + 1);
+		uint64_t key = 0;
+		const PatternRecord *r = nullptr;
+		if(hi - lo + 1 <= options.patterns->width() && pattern_key(offsets, firsts, lo, hi - lo + 1, key) && (r = options.patterns->find(key))){
+			State s = first;
+			bool legal = true;
+			for(auto x : options.patterns->plan(r, lo)){
+				int idx = -1;
+				for(int i = 0; i < n_stitches; i++){
+					if(s.beds[i] == Bed(x.first) && s.currents[i] == Needle(x.first)) idx = i;
+				}
+				int ofs = Front(x) - Back(x);
+				if(idx < 0 || std::abs(ofs) > options.max_rack || !okay_to_move_index_by_offset(s, idx, ofs)){
+					legal = false;
+					break;
+				}
+				MoveIndexByOffset(s, idx, ofs);
+			}
+			s.penalty = Penalty(s);
+			// the table plan is only an answer if it beats the plan the caller already has
+			if(legal && Reached(s) && Passes(s.xfers) < options.upper_bound){
+				log_out << "Answered from pattern table ( passes = " << (int)r->passes << " )" << std::endl;
+				plan.xfers = s.xfers;
+				plan.passes = Passes(s.xfers);
+				plan.optimal = (plan.passes <= lower_bound_passes);
+				plan.milliseconds = Elapsed();
+				return true;
+			}
+		}
+	}
+
 	//PQ.push(second);
 
 	// enqueue a bunch of safe states? 
@@ -572,17 +846,248 @@ bool exhaustive( std::vector<int> offsets, std::vector<int> firsts , std::string
 	// also add a state that puts non-zero offsets on the back-bed 
 
 	if( lower_bound_passes < 0 ){
-		std::cout << "No transfers necessary, easy out" << std::endl;
+		log_out << "No transfers necessary, easy out" << std::endl;
+		plan.optimal = true;
+		plan.milliseconds = Elapsed();
 		return true;
 	}
 
 	std::set< Signature > visited;
 	std::map <  std::map<BN, std::vector<int>>,   int > current_passes_map; // really just inverse sign
 
-	std::cout << "Starting penalty = " << first.penalty << std::endl;	
+	log_out << "Starting penalty = " << first.penalty << std::endl;	
+
+	bool timed_out = false;
+	long expanded = 0;
+
+	// bidirectional mode: also search backward from the goal over inverse transfers and
+	// meet in the middle on the machine state. Each side is ordered by passes plus an
+	// estimate of the passes to the other end. Joining two halves costs their passes, less
+	// one when the last pass of the forward half continues into the first of the backward
+	// half, so each side keeps the fewest passes per machine *and* racking/source bed of the
+	// pass at the join (a half with one more pass can still join for less) and meets every one.
+	// The estimates count distinct displacements, but a stitch can add up the rackings of
+	// several passes, so they are not a true bound: like the forward search below, they only
+	// drop new states (passes + estimate - 1 >= best), they never end the search. It ends
+	// when the queues run out, or when the fewest passes left in the forward frontier plus
+	// the fewest left in the backward one, less one, can't beat the best plan so far (any
+	// plan not found yet crosses both frontiers).
+	const size_t max_goals = 4096;
+	typedef std::map<BN, std::vector<int>> Machine;
+	// goal states: every stitch on the front bed at its target, stacked in any order
+	// that keeps firsts at the bottom
+	std::vector<Machine> goal_machines;
+	if(options.bidirectional){
+		std::map<int, std::vector<int>> stacks;
+		for(int i = 0; i < n_stitches; i++) stacks[targets[i]].push_back(i);
+		goal_machines.push_back(Machine());
+		for(auto &t : stacks){
+			std::vector<int> order = t.second;
+			std::vector<Machine> next;
+			do{
+				bool firsts_okay = true;
+				for(int k = 1; k < (int)order.size(); k++){
+					if(firsts[order[k]]) firsts_okay = false;
+				}
+				if(!firsts_okay) continue;
+				for(auto m : goal_machines){
+					m[std::make_pair(Front_Bed, t.first)] = order;
+					next.push_back(m);
+				}
+			} while(std::next_permutation(order.begin(), order.end()) && next.size() <= max_goals);
+			goal_machines.swap(next);
+			if(goal_machines.size() > max_goals){
+				log_out << "Too many goal stackings for bidirectional search, searching forward only" << std::endl;
+				goal_machines.clear();
+				break;
+			}
+		}
+	}
+	if(!goal_machines.empty()){
+		auto Occupied = [](const Machine &m)->Machine{
+			Machine r;
+			for(const auto &bn : m){
+				if(!bn.second.empty()) r.insert(bn);
+			}
+			return r;
+		};
+		// mirror of LowerBoundFromHere: every distinct displacement from the starting
+		// needle (per bed) needs a pass to get there
+		auto LowerBoundToHere = [=](const State &s)->int{
+			std::set<BN> moved;
+			for(int i = 0; i < n_stitches; i++){
+				if(s.beds[i] == Back_Bed || s.currents[i] != i){
+					moved.insert(std::make_pair(s.beds[i], s.currents[i] - i));
+				}
+			}
+			return moved.size();
+		};
+
+		// racking and source bed of the pass at the join, none for the start and goals
+		typedef std::pair<int, char> Boundary;
+		auto HeadBoundary = [=](const State &s)->Boundary{
+			if(s.xfers.empty()) return std::make_pair(INT32_MAX, '\0');
+			return std::make_pair(Front(s.xfers.back()) - Back(s.xfers.back()), Bed(s.xfers.back().first));
+		};
+		auto TailBoundary = [=](const State &s)->Boundary{
+			if(s.xfers.empty()) return std::make_pair(INT32_MAX, '\0');
+			return std::make_pair(Front(s.xfers.front()) - Back(s.xfers.front()), Bed(s.xfers.front().first));
+		};
+		typedef std::map<Machine, std::map<Boundary, State>> Closed;
+		// true if closed already has this machine and boundary at no more passes
+		auto Seen = [](const Closed &closed, const Machine &key, const Boundary &b, int passes)->bool{
+			auto m = closed.find(key);
+			if(m == closed.end()) return false;
+			auto s = m->second.find(b);
+			return s != m->second.end() && s->second.passes <= passes;
+		};
+
+		std::priority_queue< State, std::vector<State>, LessThanByEstimatedPassesThenPenalty > fwd, bwd;
+		std::multiset<int> fwd_passes, bwd_passes; // passes of every state in each frontier
+		Closed fwd_closed, bwd_closed;
+		fwd.push(first);
+		fwd_passes.insert(first.passes);
+		for(const auto &m : goal_machines){
+			State goal;
+			goal.machine = m;
+			goal.currents = targets;
+			goal.offsets.assign(n_stitches, 0);
+			goal.beds.assign(n_stitches, Front_Bed);
+			goal.est_passes = LowerBoundToHere(goal);
+			bwd.push(goal);
+			bwd_passes.insert(goal.passes);
+		}
+		log_out << "Bidirectional search from " << goal_machines.size() << " goal stackings" << std::endl;
+
+		int best = upper_bound_passes; // only interested in plans strictly better than this
+		auto Meet = [&](const State &head, const State &tail){
+			State joined = head;
+			joined.xfers.insert(joined.xfers.end(), tail.xfers.begin(), tail.xfers.end());
+			int p = Passes(joined.xfers);
+			if(p < best){
+				log_out << "Met in the middle with a solution that needs " << p << " passes." << std::endl;
+				best = p;
+				best_state = joined;
+				successes.push_back(joined);
+			}
+		};
+		auto MeetHeads = [&](const Closed &heads, const Machine &key, const State &tail){
+			auto m = heads.find(key);
+			if(m == heads.end()) return;
+			for(const auto &head : m->second) Meet(head.second, tail);
+		};
+		auto MeetTails = [&](const State &head, const Closed &tails, const Machine &key){
+			auto m = tails.find(key);
+			if(m == tails.end()) return;
+			for(const auto &tail : m->second) Meet(head, tail.second);
+		};
+		// a half that already needs best passes can't be part of a better plan
+		auto Done = [&](const State &s)->bool{
+			return s.passes >= best;
+		};
+		// same cut as the forward search makes on new states
+		auto Hopeless = [&](const State &s)->bool{
+			return s.passes + s.est_passes - 1 >= best;
+		};
+
+		while(!fwd.empty() && !bwd.empty() && best > lower_bound_passes){
+			++expanded;
+			if( options.deadline_ms > 0 && (expanded % 256) == 0 && std::chrono::steady_clock::now() > deadline){
+				log_out << "Deadline reached, returning best plan so far" << std::endl;
+				timed_out = true;
+				break;
+			}
+			if( best != INT32_MAX && *fwd_passes.begin() + *bwd_passes.begin() - 1 >= best ) break;
+
+			// grow the smaller frontier
+			bool forward = (fwd.size() <= bwd.size());
+			auto &frontier = (forward ? fwd : bwd);
+			auto &frontier_passes = (forward ? fwd_passes : bwd_passes);
+			auto &closed = (forward ? fwd_closed : bwd_closed);
+			State st = frontier.top();
+			frontier.pop();
+			frontier_passes.erase(frontier_passes.find(st.passes));
+			if(Done(st)) continue;
+			Machine key = Occupied(st.machine);
+			Boundary boundary = (forward ? HeadBoundary(st) : TailBoundary(st));
+			if(Seen(closed, key, boundary, st.passes)) continue;
+			closed[key][boundary] = st;
+			if(forward) MeetTails(st, bwd_closed, key);
+			else MeetHeads(fwd_closed, key, st);
+
+			if(forward){
+				for(int idx = 0; idx < n_stitches; idx++){
+					for(int ofs = -options.max_rack; ofs <= options.max_rack; ofs++){
+						if(!okay_to_move_index_by_offset(st, idx, ofs)) continue;
+						State top = st;
+						MoveIndexByOffset(top, idx, ofs);
+						Machine at = Occupied(top.machine);
+						top.passes = Passes(top.xfers);
+						if(Seen(fwd_closed, at, HeadBoundary(top), top.passes)) continue;
+						MeetTails(top, bwd_closed, at);
+						top.est_passes = LowerBoundFromHere(top);
+						if(Done(top) || Hopeless(top)) continue;
+						top.penalty = Penalty(top);
+						top.rack = ofs;
+						fwd.push(top);
+						fwd_passes.insert(top.passes);
+					}
+				}
+				continue;
+			}
+
+			// backward: undo a transfer that put the top k loops of a stack where they are now.
+			// Transfers reverse the stack they move, so the loops came from an empty needle on
+			// the other bed, stacked the other way up.
+			for(const auto &at : key){
+				BN to = at.first;
+				const std::vector<int> &stack = at.second;
+				for(int k = 1; k <= (int)stack.size(); k++){
+					std::vector<int> moved(stack.end() - k, stack.end());
+					std::reverse(moved.begin(), moved.end());
+					for(int ofs = -options.max_rack; ofs <= options.max_rack; ofs++){
+						BN from = (Bed(to) == Back_Bed ? std::make_pair(Front_Bed, Needle(to) + ofs) : std::make_pair(Back_Bed, Needle(to) - ofs));
+						if(key.count(from)) continue;
+						State prev = st;
+						prev.machine = key;
+						prev.machine[to].resize(stack.size() - k);
+						if(prev.machine[to].empty()) prev.machine.erase(to);
+						prev.machine[from] = moved;
+						for(auto in : moved){
+							prev.beds[in] = Bed(from);
+							prev.currents[in] = Needle(from);
+							prev.offsets[in] = targets[in] - Needle(from);
+						}
+						// only keep it if the forward transfer is legal
+						if(!okay_to_move_index_by_offset(prev, moved[0], ofs)) continue;
+						prev.xfers.insert(prev.xfers.begin(), std::make_pair(from, to));
+						prev.passes = Passes(prev.xfers);
+						if(Seen(bwd_closed, prev.machine, TailBoundary(prev), prev.passes)) continue;
+						MeetHeads(fwd_closed, prev.machine, prev);
+						prev.est_passes = LowerBoundToHere(prev);
+						if(Done(prev) || Hopeless(prev)) continue;
+						prev.penalty = Penalty(prev);
+						prev.rack = ofs;
+						bwd.push(prev);
+						bwd_passes.insert(prev.passes);
+					}
+				}
+			}
+		}
+		// nothing left for the forward-only search below
+		PQ = decltype(PQ)();
+	}
 
 	while(!PQ.empty()){
 
+		// checking the clock is not free, so only do it every so often
+		++expanded;
+		if( options.deadline_ms > 0 && (expanded % 256) == 0 && std::chrono::steady_clock::now() > deadline){
+			log_out << "Deadline reached, returning best plan so far" << std::endl;
+			timed_out = true;
+			break;
+		}
+
 		// from this state, generate _all_ possible next states
 		// 0 can go from -8 to 8
 		auto st  = PQ.top();
@@ -608,8 +1113,7 @@ bool exhaustive( std::vector<int> offsets, std::vector<int> firsts , std::string
 	
 		if( Reached(st) ){
 			int p = Passes(st.xfers);
-			assert( p>= lower_bound_passes && "pass count is not lower than lower bound!");
-			std::cout<<"Found a solution that needs " << p  <<" passes."<< std::endl;
+			log_out<<"Found a solution that needs " << p  <<" passes."<< std::endl;
 			if ( p < best_cost ){
 				best_cost = p;
 				best_state = st;
@@ -620,7 +1124,7 @@ bool exhaustive( std::vector<int> offsets, std::vector<int> firsts , std::string
 				upper_bound_passes = p;
 			}
 			if( p == lower_bound_passes){
-				std::cout<<"Found lower bound, can't do better so break ( passes = "<< p <<" )" << std::endl;
+				log_out<<"Found lower bound, can't do better so break ( passes = "<< p <<" )" << std::endl;
 				break;
 			}
 		}
@@ -634,7 +1138,7 @@ bool exhaustive( std::vector<int> offsets, std::vector<int> firsts , std::string
 
 		// what are the actions that can be sucessfully applied to top
 		for(int idx = 0; idx < n_stitches; idx++){
-			for(int ofs = -n_rack; ofs <= n_rack; ofs++){
+			for(int ofs = -options.max_rack; ofs <= options.max_rack; ofs++){
 				State top = st;
 				//std::cout<<"Act on offsets : "<< PrintOffsets(top) << " " << PrintCurrent(top) << PrintMachine(top)<<std::endl;
 				BN from = std::make_pair( top.beds[idx],  top.currents[idx]);
@@ -651,45 +1155,7 @@ bool exhaustive( std::vector<int> offsets, std::vector<int> firsts , std::string
 
 				if( okay_to_move_index_by_offset(top, idx, ofs) ){
 				
-					int prev_offset = top.offsets[idx];
-					(void)prev_offset;
-					//front-to-back
-					//std::cout<<"\t idx = "<<idx<<" "<< top.beds[idx] << top.currents[idx] << " moved to ";
-					if(top.beds[idx] == Front_Bed){
-						top.offsets[idx] += ofs;
-						top.currents[idx] -= ofs;
-					}
-					else{ //Back-to-front
-						top.offsets[idx] -= ofs;
-						top.currents[idx] += ofs;
-					}
-					top.beds[idx] = Opposite(top, idx);
-					
-					
-					//std::cout<<" to-target: "<<top.beds[idx]<<top.currents[idx]<<std::endl;
-					BN to = std::make_pair( top.beds[idx],  top.currents[idx]);
-			
-					auto froms = top.machine[from];
-					auto tos = top.machine[to];
-					std::reverse(froms.begin(), froms.end());
-					for(auto in : froms){
-						//if(in != idx){
-						//std::cout<<"\t\tidx = "<<idx<<" index " << in << " at from "<<top.beds[in] << top.currents[in] << " moved to target "<<std::endl;
-						//}
-						top.machine[to].push_back(in);
-						assert(in == idx || top.currents[in] == from.second);
-						assert(in == idx || top.beds[in] == from.first);
-						top.currents[in] = top.currents[idx];
-						top.beds[in] = top.beds[idx];
-						// if these didn't match this action would not have been possible
-						assert(in == idx || top.offsets[in] == prev_offset);
-						top.offsets[in] = top.offsets[idx];
-					}
-					top.xfers.push_back( std::make_pair(from, to));
-				//	std::cout<<"\txfer "<<Bed(from)<<Needle(from)<<" -> "<<Bed(to)<<Needle(to)<<std::endl;
-				//	Passes(top.xfers , true);
-
-					top.machine[from].clear();
+					MoveIndexByOffset(top, idx, ofs);
 					int already_passes = Passes(top.xfers);
 					int atleast_more_passes = LowerBoundFromHere(top) ;
 					if( already_passes + atleast_more_passes > upper_bound_passes){
@@ -712,19 +1178,431 @@ bool exhaustive( std::vector<int> offsets, std::vector<int> firsts , std::string
 		}
 	}
 
-	std::cout << "Found " << successes.size() << " potential solutions. " << std::endl;
-	for(int i = 0; i < (int)successes.size(); i++){
+	log_out << "Found " << successes.size() << " potential solutions. " << std::endl;
+	for(int i = 0; options.verbose && i < (int)successes.size(); i++){
 		std::cout<<"Solution " << i << "\n" << Passes(successes[i].xfers, true) << std::endl;
 	}
 
+	plan.expanded = expanded;
+	plan.milliseconds = Elapsed();
+	// the forward search keeps plans that only tie the upper bound, those are not wanted either
+	if(successes.empty() || Passes(best_state.xfers) >= options.upper_bound){
+		log_out << "No plan within upper bound " << options.upper_bound << std::endl;
+		return false;
+	}
+	// the formula bound is what every other bound and the optimal flag build on,
+	// so a plan that beats it means this row breaks an assumption; report it unsolved
+	if(Passes(best_state.xfers) < formula_lower_bound){
+		log_out << "pass count is lower than lower bound " << formula_lower_bound << ", not trusting this row" << std::endl;
+		return false;
+	}
+	plan.xfers = best_state.xfers;
+	plan.passes = Passes(best_state.xfers);
+	// the bidirectional stopping rule has only been checked against the forward search on
+	// sampled rows, so its plans only count as optimal when they meet the lower bound
+	plan.optimal = (!timed_out && goal_machines.empty()) || plan.passes == lower_bound_passes;
+	return true;
+}
+
+void write_xfers( std::ostream &out, const std::vector<Xfer> &xfers){
+	for(auto x : xfers){
+		out<<x.first.first<<x.first.second<<" "<<x.second.first<<x.second.second<<"\n";
+	}
+}
+
+// one transfer pass: every xfer from the same bed at the same racking
+struct Pass{
+	int rack = 0;
+	char from_bed = Front_Bed;
+	char direction = '-';
+	std::vector<Xfer> xfers;
+};
+
+// splits a plan into passes with the same rules as Passes() in exhaustive_plan:
+// a new pass starts whenever the racking or the source bed changes.
+// Carriage direction alternates, starting with '-' since the course was just knit left to right.
+std::vector<Pass> group_passes( const std::vector<Xfer> &xfers ){
+	std::vector<Pass> passes;
+	for(auto x : xfers){
+		int front = (x.first.first == Front_Bed ? x.first.second : x.second.second);
+		int back = (x.first.first == Front_Bed ? x.second.second : x.first.second);
+		if(passes.empty() || passes.back().rack != front - back || passes.back().from_bed != x.first.first){
+			Pass p;
+			p.rack = front - back;
+			p.from_bed = x.first.first;
+			p.direction = ((passes.size() % 2) ? '+' : '-');
+			passes.push_back(p);
+		}
+		passes.back().xfers.push_back(x);
+	}
+	return passes;
+}
+
+// output formats for results:
+//  xfers   - bare "f3 b3" lines (what exhaustive-wrapper.js reads); charts add a "row r passes p xfers k" line per row
+//  passes  - per row a line "row r passes p lower_bound l optimal 0|1 expanded e ms t",
+//            then one line per pass "pass rack R f>b|b>f +|- f3 b3 f4 b4 ..."
+//  knitout - rack/xfer lines with the row header as comments
+//  binary  - "LACEXFR1", then per row a ResultRow, its ResultPass'es, each followed by its ResultXfer's
+// a row with no plan is written as its header alone with passes -1 and optimal 0
+// (a bare xfers list just stays empty)
+enum ResultFormat{ Format_Xfers, Format_Passes, Format_Knitout, Format_Binary };
+
+bool parse_format( std::string name, ResultFormat &format ){
+	if(name == "xfers") format = Format_Xfers;
+	else if(name == "passes") format = Format_Passes;
+	else if(name == "knitout") format = Format_Knitout;
+	else if(name == "binary") format = Format_Binary;
+	else return false;
+	return true;
+}
+
+struct ResultRow{
+	int32_t row;
+	int32_t passes;
+	int32_t lower_bound;
+	int32_t optimal;
+	int64_t expanded;
+	double milliseconds;
+};
+struct ResultPass{
+	int32_t rack;
+	char from_bed;
+	char direction;
+	int16_t pad;
+	int32_t xfers;
+};
+struct ResultXfer{
+	char from_bed;
+	char to_bed;
+	int16_t pad;
+	int32_t from_needle;
+	int32_t to_needle;
+};
+static const char Results_Magic[8] = {'L','A','C','E','X','F','R','1'};
+
+// writes results one row at a time, so a batch never has to be held in memory
+struct ResultWriter{
+	std::ostream &out;
+	ResultFormat format;
+	bool chart;
+	int rack = 0; // knitout: racking the machine was last left at
+
+	ResultWriter( std::ostream &out_, ResultFormat format_, bool chart_ ) : out(out_), format(format_), chart(chart_){
+		if(format == Format_Knitout) out << ";!knitout-2\n";
+		if(format == Format_Binary) out.write(Results_Magic, sizeof(Results_Magic));
+	}
+
+	void write( int row, const Plan &found, bool solved ){
+		Plan plan = found;
+		if(!solved){
+			plan.passes = -1;
+			plan.optimal = false;
+			plan.xfers.clear();
+		}
+		if(format == Format_Xfers){
+			if(chart) out << "row " << row << " passes " << plan.passes << " xfers " << plan.xfers.size() << "\n";
+			write_xfers(out, plan.xfers);
+			return;
+		}
+		std::vector<Pass> passes = group_passes(plan.xfers);
+		if(format == Format_Binary){
+			ResultRow r = {row, plan.passes, plan.lower_bound, plan.optimal, plan.expanded, plan.milliseconds};
+			out.write((const char*)&r, sizeof(r));
+			for(const auto &p : passes){
+				ResultPass rp = {p.rack, p.from_bed, p.direction, 0, (int32_t)p.xfers.size()};
+				out.write((const char*)&rp, sizeof(rp));
+				for(auto x : p.xfers){
+					ResultXfer rx = {x.first.first, x.second.first, 0, x.first.second, x.second.second};
+					out.write((const char*)&rx, sizeof(rx));
+				}
+			}
+			return;
+		}
+		const char *comment = (format == Format_Knitout ? ";" : "");
+		out << comment << "row " << row << " passes " << plan.passes << " lower_bound " << plan.lower_bound << " optimal " << plan.optimal
+			<< " expanded " << plan.expanded << " ms " << plan.milliseconds << "\n";
+		for(const auto &p : passes){
+			if(format == Format_Knitout){
+				out << ";pass " << p.direction << "\n";
+				if(p.rack != rack) out << "rack " << p.rack << "\n";
+				rack = p.rack;
+				for(auto x : p.xfers){
+					out << "xfer " << x.first.first << x.first.second << " " << x.second.first << x.second.second << "\n";
+				}
+				continue;
+			}
+			out << "pass rack " << p.rack << " " << p.from_bed << ">" << (p.from_bed == Front_Bed ? Back_Bed : Front_Bed) << " " << p.direction;
+			for(auto x : p.xfers){
+				out << " " << x.first.first << x.first.second << " " << x.second.first << x.second.second;
+			}
+			out << "\n";
+		}
+	}
+};
+
+bool exhaustive( std::vector<int> offsets, std::vector<int> firsts , std::string outfile="out.xfers", SearchOptions options = SearchOptions(), ResultFormat format = Format_Xfers){
+	Plan plan;
+	bool ok = exhaustive_plan(offsets, firsts, plan, options);
 	// return a string 
-	std::ofstream out(outfile);
-	for(auto x : best_state.xfers){
-		
-		out<<Bed(x.first)<<Needle(x.first)<<" "<<Bed(x.second)<<Needle(x.second)<<"\n";
+	std::ofstream out(outfile, std::ios::binary);
+	ResultWriter writer(out, format, false);
+	writer.write(0, plan, ok);
+	out.close();
+	return ok;
+}
 
+
+// a row of a chart is its offsets and firsts
+typedef std::pair< std::vector<int>, std::vector<int> > Row;
+
+// reads a chart, one row per line in the same format as the command line:
+//   n o_0 ... o_n-1 f_0 ... f_n-1
+// blank lines and lines starting with '#' are skipped
+bool read_chart( std::string chartfile, std::vector<Row> &rows){
+	std::ifstream in(chartfile);
+	if(!in) {
+		std::cerr << "could not open chart " << chartfile << std::endl;
+		return false;
+	}
+	std::string line;
+	while(std::getline(in, line)){
+		std::istringstream ss(line);
+		int n = 0;
+		if( line.empty() || line[0] == '#' || !(ss >> n)) continue;
+		Row row;
+		if(n >= 0){
+			row.first.assign(n, 0);
+			row.second.assign(n, 0);
+			for(int i = 0; i < n; i++) ss >> row.first[i];
+			for(int i = 0; i < n; i++) ss >> row.second[i];
+		}
+		std::string extra;
+		if(n < 0 || !ss || (ss >> extra)){
+			std::cerr << "malformed chart row " << rows.size() << ": " << line << std::endl;
+			return false;
+		}
+		rows.push_back(row);
 	}
+	return true;
+}
+
+// solves jobs [0, n_jobs) on n_threads workers, each worker owns a deque and takes
+// from its front (so jobs finish roughly in order), idle workers steal from the back of the others
+template< typename F >
+void work_stealing_pool( int n_jobs, int n_threads, F solve){
+	n_threads = std::max(1, std::min(n_threads, n_jobs));
+	struct WorkQueue{
+		std::mutex lock;
+		std::deque<int> jobs;
+	};
+	std::vector<WorkQueue> queues(n_threads);
+	for(int j = 0; j < n_jobs; j++){
+		queues[j % n_threads].jobs.push_back(j);
+	}
+	auto next_job = [&](int w, int &job)->bool{
+		{
+			std::lock_guard<std::mutex> guard(queues[w].lock);
+			if(!queues[w].jobs.empty()){
+				job = queues[w].jobs.front();
+				queues[w].jobs.pop_front();
+				return true;
+			}
+		}
+		for(int k = 1; k < n_threads; k++){
+			WorkQueue &victim = queues[(w + k) % n_threads];
+			std::lock_guard<std::mutex> guard(victim.lock);
+			if(!victim.jobs.empty()){
+				job = victim.jobs.back();
+				victim.jobs.pop_back();
+				return true;
+			}
+		}
+		return false;
+	};
+	std::vector<std::thread> workers;
+	for(int w = 0; w < n_threads; w++){
+		workers.emplace_back([&, w](){
+			int job = 0;
+			while(next_job(w, job)){
+				solve(job);
+			}
+		});
+	}
+	for(auto &t : workers) t.join();
+}
+
+// pipeline mode: solves every row of a chart, identical rows are solved once
+// and the unique rows are solved concurrently.
+// outfile gets the plans in row order (see ResultFormat); each row is written as soon as
+// it and all rows before it are solved, and a plan is dropped once its last row is out
+bool exhaustive_chart( std::string chartfile, std::string outfile, int n_threads, const PatternTable *patterns = nullptr, ResultFormat format = Format_Xfers){
+	std::vector<Row> rows;
+	if(!read_chart(chartfile, rows)) return false;
+
+	std::map<Row, int> unique_index;
+	std::vector<int> row_to_unique;
+	std::vector<const Row*> unique_rows;
+	for(const auto &row : rows){
+		auto it = unique_index.find(row);
+		if(it == unique_index.end()){
+			it = unique_index.insert(std::make_pair(row, (int)unique_rows.size())).first;
+			unique_rows.push_back(&it->first);
+		}
+		row_to_unique.push_back(it->second);
+	}
+	std::cout << "chart has " << rows.size() << " rows, " << unique_rows.size() << " unique, solving on " << n_threads << " threads" << std::endl;
+
+	std::vector<Plan> plans(unique_rows.size());
+	std::vector<char> solved(unique_rows.size(), 0);
+	std::vector<char> done(unique_rows.size(), 0);
+	std::vector<int> rows_left(unique_rows.size(), 0);
+	for(auto u : row_to_unique) rows_left[u]++;
+
+	bool ok = true;
+	std::ofstream out(outfile, std::ios::binary);
+	ResultWriter writer(out, format, true);
+	std::mutex output_lock;
+	int next_row = 0;
+
+	SearchOptions options;
+	options.verbose = false;
+	options.patterns = patterns;
+	work_stealing_pool(unique_rows.size(), n_threads, [&](int u){
+		Plan plan;
+		bool found = exhaustive_plan(unique_rows[u]->first, unique_rows[u]->second, plan, options);
+		std::lock_guard<std::mutex> guard(output_lock);
+		plans[u] = plan;
+		solved[u] = found;
+		done[u] = 1;
+		while(next_row < (int)rows.size() && done[row_to_unique[next_row]]){
+			int v = row_to_unique[next_row];
+			ok = ok && solved[v];
+			writer.write(next_row, plans[v], solved[v]);
+			if(solved[v]) std::cout << "row " << next_row << " passes " << plans[v].passes << " (lower bound " << plans[v].lower_bound << ")" << std::endl;
+			else std::cout << "row " << next_row << " unsolved (cables, two firsts on one target, below the lower bound, or past the upper bound)" << std::endl;
+			if(--rows_left[v] == 0) plans[v] = Plan();
+			next_row++;
+		}
+		out.flush();
+	});
 	out.close();
+	return ok;
+}
+
+
+// offline builder for the pattern table: solves every cable-free window of up to width
+// stitches with offsets in [-max_offset, max_offset], and every way of marking one loop
+// of each stack as first
+bool build_patterns( int width, int max_offset, std::string outfile, int n_threads){
+	// keys have room for offsets up to 3, but only tables up to 1 have been checked
+	// entry by entry against the search
+	if(width < 1 || width > 15 || max_offset < 0 || max_offset > 1){
+		std::cerr << "pattern tables need 1 <= width <= 15 and 0 <= max_offset <= 1" << std::endl;
+		return false;
+	}
+	std::vector<Row> windows;
+	std::vector<int> offsets;
+	std::function<void()> enumerate = [&](){
+		int i = offsets.size();
+		if(i > 0){
+			// every way of choosing at most one first per stack
+			std::map<int, std::vector<int>> stacks;
+			for(int j = 0; j < i; j++) stacks[j + offsets[j]].push_back(j);
+			std::vector< std::vector<int> > marked(1, std::vector<int>(i, 0));
+			for(auto &t : stacks){
+				if(t.second.size() < 2) continue;
+				std::vector< std::vector<int> > next = marked;
+				for(auto f : marked){
+					for(auto j : t.second){
+						f[j] = 1;
+						next.push_back(f);
+						f[j] = 0;
+					}
+				}
+				marked.swap(next);
+			}
+			for(auto &f : marked) windows.push_back(std::make_pair(offsets, f));
+		}
+		if(i == width) return;
+		for(int o = -max_offset; o <= max_offset; o++){
+			// no cables: targets never move left
+			if(i > 0 && i + o < i-1 + offsets[i-1]) continue;
+			offsets.push_back(o);
+			enumerate();
+			offsets.pop_back();
+		}
+	};
+	enumerate();
+	std::cout << "solving " << windows.size() << " windows on " << n_threads << " threads" << std::endl;
+
+	// solve one width at a time and write the table after each, so that the wider
+	// windows get the narrower ones as lower bounds (and direct answers)
+	std::vector<PatternRecord> records;
+	std::vector<PatternXfer> xfers;
+	int unsolved = 0;
+	PatternTable table;
+	SearchOptions options;
+	options.verbose = false;
+	// the table is used as a lower bound, so only the forward search's plans go in
+	// (the bidirectional one doesn't claim optimality)
+	options.bidirectional = false;
+	for(int w = 1; w <= width; w++){
+		std::vector<int> todo;
+		for(int i = 0; i < (int)windows.size(); i++){
+			if((int)windows[i].first.size() == w) todo.push_back(i);
+		}
+		std::vector<Plan> plans(todo.size());
+		std::vector<char> solved(todo.size(), 0);
+		options.patterns = (table.header ? &table : nullptr);
+		work_stealing_pool(todo.size(), n_threads, [&](int t){
+			const Row &row = windows[todo[t]];
+			solved[t] = exhaustive_plan(row.first, row.second, plans[t], options) && plans[t].optimal;
+		});
+
+		for(int t = 0; t < (int)todo.size(); t++){
+			if(!solved[t]){
+				unsolved++;
+				continue;
+			}
+			PatternRecord r;
+			bool ok = pattern_key(windows[todo[t]].first, windows[todo[t]].second, 0, w, r.key);
+			assert(ok && "enumerated windows fit in the table");
+			(void)ok;
+			r.first_xfer = xfers.size();
+			r.xfers = plans[t].xfers.size();
+			r.passes = plans[t].passes;
+			r.width = w;
+			for(auto x : plans[t].xfers){
+				PatternXfer px;
+				px.from_bed = x.first.first;
+				px.from_needle = x.first.second;
+				px.to_bed = x.second.first;
+				px.to_needle = x.second.second;
+				xfers.push_back(px);
+			}
+			records.push_back(r);
+		}
+		std::sort(records.begin(), records.end(), [](const PatternRecord &a, const PatternRecord &b){ return a.key < b.key; });
+
+		PatternHeader header;
+		memcpy(header.magic, Patterns_Magic, sizeof(Patterns_Magic));
+		header.width = w;
+		header.max_offset = max_offset;
+		header.records = records.size();
+		header.xfers = xfers.size();
+		table.close();
+		std::ofstream out(outfile, std::ios::binary);
+		out.write((const char*)&header, sizeof(header));
+		out.write((const char*)records.data(), records.size() * sizeof(PatternRecord));
+		out.write((const char*)xfers.data(), xfers.size() * sizeof(PatternXfer));
+		out.close();
+		if(!out || !table.open(outfile)){
+			std::cerr << "could not write pattern table " << outfile << std::endl;
+			return false;
+		}
+		std::cout << "width " << w << ": " << records.size() << " patterns so far (" << unsolved << " unsolved)" << std::endl;
+	}
 	return true;
 }
 
@@ -732,8 +1610,57 @@ bool exhaustive( std::vector<int> offsets, std::vector<int> firsts , std::string
 
 int main(int argc, char* argv[]){
 
+	// these may come first, in any order, in any of the modes below:
+	//  --format xfers|passes|knitout|binary
+	//  --patterns table.pdb|none (default: Patterns_File, if the working directory has one)
+	ResultFormat format = Format_Xfers;
+	std::string patterns_file = Patterns_File;
+	bool patterns_required = false;
+	while(argc > 2 && (std::string(argv[1]) == "--format" || std::string(argv[1]) == "--patterns")){
+		if(std::string(argv[1]) == "--format" && !parse_format(argv[2], format)){
+			std::cerr << "Unknown format '" << argv[2] << "', expecting xfers, passes, knitout or binary." << std::endl;
+			return 1;
+		}
+		if(std::string(argv[1]) == "--patterns"){
+			patterns_file = argv[2];
+			patterns_required = true;
+		}
+		argv[2] = argv[0];
+		argv += 2;
+		argc -= 2;
+	}
+
+	// ./exhaustive --build-patterns width max_offset patterns.pdb [threads]
+	if(argc > 4 && std::string(argv[1]) == "--build-patterns"){
+		int n_threads = std::thread::hardware_concurrency();
+		if(argc > 5) n_threads = atoi(argv[5]);
+		if(n_threads < 1) n_threads = 1;
+		return build_patterns(atoi(argv[2]), atoi(argv[3]), argv[4], n_threads) ? 0 : 1;
+	}
+
+	PatternTable patterns;
+	const PatternTable *loaded = nullptr;
+	if(patterns_file != "none"){
+		if(patterns.open(patterns_file)){
+			loaded = &patterns;
+			std::cout << "using pattern table " << patterns_file << " (width " << patterns.width() << ")" << std::endl;
+		}
+		else if(patterns_required){
+			std::cerr << "could not load pattern table " << patterns_file << std::endl;
+			return 1;
+		}
+	}
+
+	// ./exhaustive --chart chart.txt out.xfers [threads]
+	if(argc > 3 && std::string(argv[1]) == "--chart"){
+		int n_threads = std::thread::hardware_concurrency();
+		if(argc > 4) n_threads = atoi(argv[4]);
+		if(n_threads < 1) n_threads = 1;
+		return exhaustive_chart(argv[2], argv[3], n_threads, loaded, format) ? 0 : 1;
+	}
+
 	if(argc > 1 ){
-		n_stitches = atoi( argv[1] );
+		int n_stitches = atoi( argv[1] );
 		std::vector<int> offsets;
 		std::vector<int>firsts;
 		for(int i = 2; i < 2 + n_stitches; i++){
@@ -742,14 +1669,19 @@ int main(int argc, char* argv[]){
 		for(int i = 2 + n_stitches; i < 2 +2*n_stitches; i++){
 			firsts.push_back(atoi(argv[i]) );
 		}
-		
-		return exhaustive(offsets, firsts, argv[2+2*n_stitches]);
+		// optional: upper bound on passes (from a known plan), deadline in milliseconds,
+		// 1 to search bidirectionally and the largest racking to use
+		SearchOptions options;
+		options.patterns = loaded;
+		if(argc > 3 + 2*n_stitches) options.upper_bound = atoi(argv[3+2*n_stitches]);
+		if(argc > 4 + 2*n_stitches) options.deadline_ms = atoi(argv[4+2*n_stitches]);
+		if(argc > 5 + 2*n_stitches) options.bidirectional = atoi(argv[5+2*n_stitches]);
+		if(argc > 6 + 2*n_stitches) options.max_rack = std::max(1, atoi(argv[6+2*n_stitches]));
+		return exhaustive(offsets, firsts, argv[2+2*n_stitches], options, format) ? 0 : 1;
 	}
 	
 	if(argc < 2){	
-		//n_stitches = 3;
 		//exhaustive({1,1,0},{0,0,0});
-		n_stitches = 24;	
 		//exhaustive( {3,2,1, 1, 2, 1}, {0, 0,1, 0, 0, 0} , "exhmain.xfers");	
 	    //exhaustive( {0,-1,-2,-2,-3,-3}, {0, 0, 0, 0, 0,  0}, "exhmain.xfers");
 		exhaustive({ 0,0,0,0,0,0,0,0,0,0,1, 1, 1, 1, 0, 0, 1, 1, 1, 0, 0, 0, 1, 0}, { 0, 0,0,0,0,0,0,0,0,0,  0,0,1,0, 0,0, 0, 0, 0, 0, 0, 0, 0, 0},"exhmain.xfers");
@@ -5,9 +5,45 @@
 // exhaustive-wrapper is a js wrapper that calls exhaustive ( the executive built for exhaustive-search.cpp )
 // the process is sync executed and results are dumped into out_file over which xfer is called
 // if running simultaneous versions of the wrapper, change out_file name
+// options (optional):
+//   upper_bound: passes of a plan already in hand, only strictly better plans are searched for
+//   deadline: milliseconds after which the search gives up and returns its best plan so far
+//   bidirectional: also search backward from the goal and meet in the middle
+//   max_rack: largest racking the plan may use (exhaustive defaults to 8)
+// returns false without calling xfer if exhaustive did not find a plan,
+// otherwise {passes, lower_bound, optimal, expanded, milliseconds} for the plan
 var child_process = require("child_process");
 var fs = require("fs");
-function exhaustive_transfers( offsets, firsts, xfer){
+
+// read_results parses the 'passes' format written by exhaustive --format passes:
+//   row <r> passes <p> lower_bound <l> optimal <0|1> expanded <e> ms <t>
+//   (passes is -1, with no pass lines, for a row exhaustive could not plan)
+//   pass rack <R> f>b|b>f <+|-> f3 b3 f4 b4 ...
+// calls xfer(row, fromBed, fromIndex, toBed, toIndex) in plan order and
+// returns one result per row, with solved false for rows that have no plan
+function read_results( text, xfer ){
+	var results = [];
+	text.split(/\n/).forEach(function(line){
+		if(line==="")return;
+		var h = /^row (\d+) passes (-?\d+) lower_bound (-?\d+) optimal ([01]) expanded (\d+) ms ([-+.e\d]+)$/.exec(line);
+		if(h){
+			results.push({'row':parseInt(h[1]), 'solved':parseInt(h[2]) >= 0, 'passes':parseInt(h[2]), 'lower_bound':parseInt(h[3]),
+				'optimal':h[4]==='1', 'expanded':parseInt(h[5]), 'milliseconds':parseFloat(h[6])});
+			return;
+		}
+		var tokens = line.split(' ');
+		console.assert( tokens[0] === 'pass' && results.length > 0, " line is a pass of a row ");
+		for(let i = 5; i + 1 < tokens.length; i+=2){
+			var f = /^([fb])([-+]?\d+)$/.exec(tokens[i]);
+			var t = /^([fb])([-+]?\d+)$/.exec(tokens[i+1]);
+			console.assert( f && t , " x is a valid transfer ");
+			xfer(results[results.length-1].row, f[1], parseInt(f[2]), t[1], parseInt(t[2]));
+		}
+	});
+	return results;
+}
+
+function exhaustive_transfers( offsets, firsts, xfer, options){
 
 	var out_file = "out.xfers";
 	var args = " " + offsets.length.toString() + " ";;
@@ -17,35 +53,72 @@ function exhaustive_transfers( offsets, firsts, xfer){
 	for(let i = 0; i < firsts.length; i++){
 		args += (firsts[i] ? " 1 " : " 0  ");
 	}
+	args += " " + out_file;
+	if (typeof(options) === 'undefined') options = {};
+	if ('upper_bound' in options || 'deadline' in options || options.bidirectional || 'max_rack' in options) {
+		args += " " + ('upper_bound' in options ? options.upper_bound.toString() : "2147483647");
+		args += " " + ('deadline' in options ? options.deadline.toString() : "0");
+		args += (options.bidirectional ? " 1" : " 0");
+		if ('max_rack' in options) args += " " + options.max_rack.toString();
+	}
 	console.log(args);
-	// why does sync not wokr
 	try{
-		child_process.execSync("./exhaustive " + args + " "+ out_file, {stdio:[0,1,2]});
+		child_process.execSync("./exhaustive --format passes " + args, {stdio:[0,1,2]});
 	}
 	catch(c){
-		//  TODO check how this must be written, for now __seems__ to work
-		//	console.log("Errors:", c);
+		// exhaustive exits with 1 when it has no plan (e.g. nothing beats upper_bound)
+		return false;
 	}
 
-	var xfers = [];
 	let res = fs.readFileSync("./"+out_file,'utf8');
+	let results = read_results(res, function(row, fromBed, fromIndex, toBed, toIndex){
+		xfer(fromBed, fromIndex, toBed, toIndex);
+		console.log(fromBed+fromIndex + ' -> ' + toBed+toIndex);
+	});
+	console.assert(results.length === 1, "must have exactly one plan");
+	
+	let result = results[0];
+	delete result.row;
+	delete result.solved;
+	return result;
+}
 
-	res.split(/\s+/).forEach(function(bn){
-		if(bn==="")return;
-		var x = /^([fb])([-+]?\d+)$/.exec(bn);
-		console.assert( x , " x is a valid argument ");
-		xfers.push({'b':x[1], 'n':parseInt(x[2])});
+// exhaustive_chart_transfers solves a whole chart with one call to exhaustive,
+// chart is an array of {offsets, firsts} rows; identical rows are only solved once
+// and unique rows are solved in parallel.
+// xfer is called with the row index first, in row order
+// returns per row {row, solved, passes, lower_bound, optimal, expanded, milliseconds};
+// rows exhaustive could not plan (e.g. cables) have solved false and passes -1
+function exhaustive_chart_transfers( chart, xfer, threads){
+
+	var chart_file = "out.chart";
+	var out_file = "out.xfers";
+	var lines = "";
+	chart.forEach(function(row){
+		console.assert(row.offsets.length === row.firsts.length, "offsets and firsts must have the same size");
+		lines += row.offsets.length.toString();
+		row.offsets.forEach(function(o){ lines += " " + o.toString(); });
+		row.firsts.forEach(function(f){ lines += (f ? " 1" : " 0"); });
+		lines += "\n";
 	});
-	console.assert(xfers.length%2 == 0 , "must have src and dst");
-	for(let i = 0; i < xfers.length; i+=2){
-		xfer(xfers[i].b, xfers[i].n, xfers[i+1].b, xfers[i+1].n);
-		console.log(xfers[i].b+xfers[i].n + ' -> ' + xfers[i+1].b+xfers[i+1].n);
+	fs.writeFileSync(chart_file, lines);
+	try{
+		child_process.execSync("./exhaustive --format passes --chart " + chart_file + " " + out_file + (threads ? " " + threads.toString() : ""), {stdio:[0,1,2]});
 	}
-	
-	//console.log("result from file \n", res);
+	catch(c){
+		// exhaustive exits with 1 when some row has no plan, every row is still in out_file
+		if(c.status !== 1) throw c;
+	}
+
+	let res = fs.readFileSync("./"+out_file,'utf8');
+	let results = read_results(res, xfer);
+	console.assert(results.length === chart.length, "must have a plan for every row");
+	return results;
 }
 
 exports.exhaustive_transfers = exhaustive_transfers;
+exports.exhaustive_chart_transfers = exhaustive_chart_transfers;
+exports.read_results = read_results;
 
 if (require.main === module){
 
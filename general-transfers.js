@@ -181,6 +181,11 @@ function general_transfers(offsets, firsts, orders, limit, outXfer) {
 
 		let sl = limit_offsets(remaining, limit);
 
+		//limit_offsets won't split a decrease, so one that can't be reached within limit never resolves:
+		if (sl.shortOffsets.every(function(o){ return o === 0; })) {
+			throw "general_transfers can't make progress on these offsets within racking limit " + limit;
+		}
+
 		let atOffsets = [];
 		for (let i = 0; i < offsets.length; ++i) {
 			atOffsets.push(fc.flatOffsets[i] - remaining[i]);
@@ -0,0 +1,171 @@
+#!/bin/sh
+':' //; exec "$(command -v nodejs || command -v node)" "$0" "$@"
+"use strict";
+
+//portfolio_transfers picks the best plan from several planners.
+// The fast heuristic planners (flat, cse, school bus bridge, general) run first;
+// if one of them already meets the lower bound its plan is used as-is.
+// Otherwise the best heuristic pass count is handed to exhaustive as its
+// upper bound, so the search only looks for strictly better plans and
+// prunes from the first node; exhaustive gives up at the deadline.
+//Parameters:
+// offsets, firsts, orders, limit: as for general_transfers; plans that rack
+//   further than limit are thrown out and exhaustive only racks up to limit
+// xfer: output function
+// options (optional):
+//   deadline: milliseconds for the whole portfolio (default 10000)
+//
+// returns {planner:"name", passes:N, lower_bound:M}
+
+const testDriver = require('./test-driver.js');
+const flat_transfers = require('./flat-transfers.js').flat_transfers;
+const cse_transfers = require('./cse-transfers.js').cse_transfers;
+const school_bus_bridge = require('./school-bus-bridge.js').school_bus_bridge;
+const general_transfers = require('./general-transfers.js').general_transfers;
+const exhaustive_transfers = require('./exhaustive-wrapper.js').exhaustive_transfers;
+
+const planners = [
+	{name:'flat', method:function(offsets, firsts, orders, limit, xfer) {
+		flat_transfers(offsets, firsts, xfer);
+	}},
+	{name:'cse', method:function(offsets, firsts, orders, limit, xfer) {
+		cse_transfers(offsets, firsts, xfer, {ignoreFirsts:false}, limit);
+	}},
+	{name:'school-bus-bridge', method:function(offsets, firsts, orders, limit, xfer) {
+		school_bus_bridge(offsets, firsts, -limit, limit, xfer);
+	}},
+	{name:'general', method:general_transfers},
+];
+
+//same lower bound exhaustive starts from, so that a heuristic plan that meets it
+// is one exhaustive would stop at as well:
+function lower_bound_passes(offsets, firsts) {
+	let ofs = new Set();
+	for (let i = 0; i < offsets.length; ++i) {
+		if (offsets[i] !== 0 || !firsts[i]) ofs.add(offsets[i]);
+	}
+	let all_zeros = offsets.every(function(o) { return o === 0; });
+	return (all_zeros ? 0 : ofs.size);
+}
+
+//counts passes the same way as Passes() in exhaustive-search.cpp:
+// a new pass starts whenever racking or the source bed changes
+function count_passes(log) {
+	let passes = 0;
+	let rack = null;
+	let from_front = null;
+	log.forEach(function(cmd){
+		let m = cmd.match(/^xfer ([fb])s?(-?\d+) ([fb])s?(-?\d+)$/);
+		console.assert(m, "log entries look like 'xfer f0 b0'");
+		let front = parseInt(m[1] === 'f' ? m[2] : m[4]);
+		let back = parseInt(m[1] === 'f' ? m[4] : m[2]);
+		if (passes === 0 || front - back !== rack || (m[1] === 'f') !== from_front) {
+			passes += 1;
+			rack = front - back;
+			from_front = (m[1] === 'f');
+		}
+	});
+	return passes;
+}
+
+//largest |racking| used by a log
+function max_rack(log) {
+	let rack = 0;
+	log.forEach(function(cmd){
+		let m = cmd.match(/^xfer ([fb])s?(-?\d+) ([fb])s?(-?\d+)$/);
+		console.assert(m, "log entries look like 'xfer f0 b0'");
+		rack = Math.max(rack, Math.abs(parseInt(m[2]) - parseInt(m[4])));
+	});
+	return rack;
+}
+
+function portfolio_transfers(offsets, firsts, orders, limit, xfer, options) {
+	if (typeof(options) === 'undefined') options = {};
+	const deadline = ('deadline' in options ? options.deadline : 10000);
+	const started = Date.now();
+	const lower_bound = lower_bound_passes(offsets, firsts);
+
+	let best = null;
+	for (let p = 0; p < planners.length; ++p) {
+		let log;
+		try {
+			log = testDriver.test(planners[p].method, offsets, firsts, orders, limit, {ignoreStacks:true, ignoreEmpty:true}).log;
+		} catch (e) {
+			//planner does not handle this row (or produced a bad plan)
+			console.log(planners[p].name + " failed: " + e);
+			continue;
+		}
+		let passes = count_passes(log);
+		console.log(planners[p].name + ": " + passes + " passes (lower bound " + lower_bound + ")");
+		if (max_rack(log) > limit) {
+			//e.g. flat_transfers doesn't take a limit
+			console.log(planners[p].name + " racks further than limit " + limit);
+			continue;
+		}
+		if (best === null || passes < best.passes) {
+			best = {planner:planners[p].name, passes:passes, log:log};
+		}
+		if (best.passes <= lower_bound) break;
+	}
+
+	if (best === null || best.passes > lower_bound) {
+		const remaining = deadline - (Date.now() - started);
+		let xfers = [];
+		let exh_options = {deadline:Math.max(1, remaining), max_rack:limit};
+		if (best !== null) exh_options.upper_bound = best.passes;
+		//false if exhaustive has no better plan or can't plan the row (e.g. cables),
+		// otherwise its result, with passes/lower_bound/optimal from the search itself
+		let found = exhaustive_transfers(offsets, firsts, function(fromBed, fromIndex, toBed, toIndex) {
+			xfers.push("xfer " + fromBed + fromIndex + " " + toBed + toIndex);
+		}, exh_options);
+		if (found && max_rack(xfers) <= limit && (best === null || found.passes < best.passes)) {
+			best = {planner:'exhaustive', passes:found.passes, log:xfers};
+		}
+	}
+
+	if (best === null) throw "No planner could handle this row.";
+
+	best.log.forEach(function(cmd){
+		let m = cmd.match(/^xfer ([fb]s?)(-?\d+) ([fb]s?)(-?\d+)$/);
+		xfer(m[1], parseInt(m[2]), m[3], parseInt(m[4]));
+	});
+	return {planner:best.planner, passes:best.passes, lower_bound:lower_bound};
+}
+
+exports.portfolio_transfers = portfolio_transfers;
+exports.count_passes = count_passes;
+
+//-------------------------------------------------
+//testing code:
+
+if (require.main === module) {
+	console.log("Doing some portfolio transfers.");
+
+	if (process.argv.length > 2) {
+		testDriver.runTests(portfolio_transfers, {
+			skipCables:true,
+			ignoreStacks:true,
+			ignoreEmpty:true,
+			outDir:'results/portfolio'
+		});
+		return;
+	}
+
+	function test(offsets, firsts, limit) {
+		let orders = [];
+		while (orders.length < offsets.length) orders.push(0);
+		let result;
+		testDriver.test(function(offsets, firsts, orders, limit, xfer) {
+			result = portfolio_transfers(offsets, firsts, orders, limit, xfer);
+		}, offsets, firsts, orders, limit, {ignoreStacks:true, ignoreEmpty:true});
+		console.log("\x1b[32m" + result.planner + ": " + result.passes + " passes, lower bound " + result.lower_bound + "\x1b[0m");
+	}
+
+	test([ 1, 0,-1, 0, 0, 0],
+	     [ 0, 0, 1, 0, 0, 0], 1);
+	test([-4, 2, 1, 2, 1, 0],
+	     [ 0, 1, 0, 1, 0, 0], 4);
+	test([ 0,-1,-1, 0, 1, 1, 1, 0,-1, 1, 0, 0],
+	     [ 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 1, 0], 1);
+
+}